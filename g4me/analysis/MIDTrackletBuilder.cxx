@@ -0,0 +1,164 @@
+#include "MIDTrackletBuilder.h"
+#include "MIDTrackletSelector.h"
+#include "TVector3.h"
+#include "TMath.h"
+
+#include <vector>
+#include <algorithm>
+
+MIDTrackletBuilder::MIDTrackletBuilder(MIDTrackletSelector *selector) {
+
+  mSelector         = selector;
+  mIsGridEnabled    = kFALSE;
+  mCellSizeEta      = 0;
+  mCellSizePhi      = 0;
+  mEventCellSizeEta = 0;
+  mEtaMin           = 0;
+  mNCellsEta        = 0;
+  mNCellsPhi        = 0;
+  mNCandidatePairs  = 0;
+
+  if (!mSelector || !(mSelector->IsSelectorSetup())) {
+    printf("ERROR: MIDTrackletBuilder needs an initialized MIDTrackletSelector\n");
+    return;
+  }
+
+  // the cells must be at least as large as the largest |deltaEta| and |deltaPhi| accepted by the selector, so that
+  // any selectable pair of hits is found in the 3x3 cells around the hit of the first layer
+
+  double deltaEtaMin, deltaEtaMax, deltaPhiMin, deltaPhiMax;
+  mSelector -> GetDeltaEtaRange(deltaEtaMin, deltaEtaMax);
+  mSelector -> GetDeltaPhiRange(deltaPhiMin, deltaPhiMax);
+
+  mCellSizeEta = TMath::Max(TMath::Abs(deltaEtaMin), TMath::Abs(deltaEtaMax));
+  mCellSizePhi = TMath::Max(TMath::Abs(deltaPhiMin), TMath::Abs(deltaPhiMax));
+
+  if (mCellSizeEta > 0 && mCellSizePhi > 0) {
+    mNCellsPhi     = TMath::Max(1, int(TMath::TwoPi()/mCellSizePhi));
+    mCellSizePhi   = TMath::TwoPi()/mNCellsPhi;
+    mIsGridEnabled = kTRUE;
+  }
+  else printf("WARNING: empty tracklet acceptance, MIDTrackletBuilder will test all the pairs of hits\n");
+
+}
+
+//====================================================================================================================================================
+
+void MIDTrackletBuilder::BuildTracklets(const MIDLayerHits_t &hitsLayer1, const MIDLayerHits_t &hitsLayer2, std::vector<std::pair<int,int>> &tracklets, bool evalEta) {
+
+  tracklets.clear();
+  mNCandidatePairs = 0;
+
+  if (!mSelector || !(mSelector->IsSelectorSetup())) return;
+
+  const int nHitsLayer1 = hitsLayer1.size();
+  const int nHitsLayer2 = hitsLayer2.size();
+  if (!nHitsLayer1 || !nHitsLayer2) return;
+
+  mCandX1.clear();  mCandY1.clear();  mCandZ1.clear();
+  mCandX2.clear();  mCandY2.clear();  mCandZ2.clear();
+  mCandPairs.clear();
+
+  if (mIsGridEnabled) FillGrid(hitsLayer2);
+
+  for (int iHitLayer1=0; iHitLayer1<nHitsLayer1; iHitLayer1++) {
+
+    mCandidates.clear();
+
+    if (mIsGridEnabled) {
+
+      const int iCellEta = EtaCell(MIDTrackletSelector::PseudoRapidity(hitsLayer1.x[iHitLayer1], hitsLayer1.y[iHitLayer1], hitsLayer1.z[iHitLayer1]));
+      const int iCellPhi = PhiCell(MIDTrackletSelector::Phi(hitsLayer1.x[iHitLayer1], hitsLayer1.y[iHitLayer1]));
+
+      const int iCellEtaMin = TMath::Max(0, iCellEta-1);
+      const int iCellEtaMax = TMath::Min(mNCellsEta-1, iCellEta+1);
+
+      // phi is periodic: with less than 3 cells, the neighbouring cells are all the cells
+      const int nNeighboursPhi = TMath::Min(3, mNCellsPhi);
+
+      for (int jCellEta=iCellEtaMin; jCellEta<=iCellEtaMax; jCellEta++) {
+	for (int iNeighbourPhi=0; iNeighbourPhi<nNeighboursPhi; iNeighbourPhi++) {
+	  const int jCellPhi = (nNeighboursPhi < 3) ? iNeighbourPhi : (iCellPhi - 1 + iNeighbourPhi + mNCellsPhi) % mNCellsPhi;
+	  const int jCell = jCellEta*mNCellsPhi + jCellPhi;
+	  for (int iEntry=mCellFirstHit[jCell]; iEntry<mCellFirstHit[jCell+1]; iEntry++) mCandidates.push_back(mCellHits[iEntry]);
+	}
+      }
+
+      // same ordering as a plain loop over the hits of the second layer
+      std::sort(mCandidates.begin(), mCandidates.end());
+
+    }
+    else {
+      for (int iHitLayer2=0; iHitLayer2<nHitsLayer2; iHitLayer2++) mCandidates.push_back(iHitLayer2);
+    }
+
+    for (int iHitLayer2 : mCandidates) {
+      mCandX1.push_back(hitsLayer1.x[iHitLayer1]);
+      mCandY1.push_back(hitsLayer1.y[iHitLayer1]);
+      mCandZ1.push_back(hitsLayer1.z[iHitLayer1]);
+      mCandX2.push_back(hitsLayer2.x[iHitLayer2]);
+      mCandY2.push_back(hitsLayer2.y[iHitLayer2]);
+      mCandZ2.push_back(hitsLayer2.z[iHitLayer2]);
+      mCandPairs.emplace_back(iHitLayer1, iHitLayer2);
+    }
+
+  }
+
+  mNCandidatePairs = mCandPairs.size();
+
+  MIDTrackletBatch_t batch;
+  batch.n  = mNCandidatePairs;
+  batch.x1 = mCandX1.data();  batch.y1 = mCandY1.data();  batch.z1 = mCandZ1.data();
+  batch.x2 = mCandX2.data();  batch.y2 = mCandY2.data();  batch.z2 = mCandZ2.data();
+
+  mCandMask.resize(mNCandidatePairs);
+  mSelector -> SelectMIDTracklets(batch, mCandMask.data(), evalEta);
+
+  for (long iCand=0; iCand<mNCandidatePairs; iCand++) {
+    if (mCandMask[iCand]) tracklets.push_back(mCandPairs[iCand]);
+  }
+
+}
+
+//====================================================================================================================================================
+
+void MIDTrackletBuilder::FillGrid(const MIDLayerHits_t &hitsLayer2) {
+
+  const int nHits = hitsLayer2.size();
+
+  mEtaLayer2.resize(nHits);
+  mPhiLayer2.resize(nHits);
+  mHitCell.resize(nHits);
+
+  double etaMax = 0;
+  for (int iHit=0; iHit<nHits; iHit++) {
+    mEtaLayer2[iHit] = MIDTrackletSelector::PseudoRapidity(hitsLayer2.x[iHit], hitsLayer2.y[iHit], hitsLayer2.z[iHit]);
+    mPhiLayer2[iHit] = MIDTrackletSelector::Phi(hitsLayer2.x[iHit], hitsLayer2.y[iHit]);
+    if (iHit == 0 || mEtaLayer2[iHit] < mEtaMin) mEtaMin = mEtaLayer2[iHit];
+    if (iHit == 0 || mEtaLayer2[iHit] > etaMax)  etaMax  = mEtaLayer2[iHit];
+  }
+
+  // larger cells only add candidates, hence the number of eta cells can be safely bounded
+  const int nMaxCellsEta = 4096;
+  mEventCellSizeEta = TMath::Max(mCellSizeEta, (etaMax-mEtaMin)/(nMaxCellsEta-1));
+  mNCellsEta = int((etaMax-mEtaMin)/mEventCellSizeEta) + 1;
+
+  // counting sort of the hits by cell
+
+  const int nCells = mNCellsEta*mNCellsPhi;
+  mCellFirstHit.assign(nCells+1, 0);
+
+  for (int iHit=0; iHit<nHits; iHit++) {
+    const int iCellEta = TMath::Min(mNCellsEta-1, EtaCell(mEtaLayer2[iHit]));
+    mHitCell[iHit] = iCellEta*mNCellsPhi + PhiCell(mPhiLayer2[iHit]);
+    mCellFirstHit[mHitCell[iHit]+1]++;
+  }
+  for (int iCell=0; iCell<nCells; iCell++) mCellFirstHit[iCell+1] += mCellFirstHit[iCell];
+
+  mCellHits.resize(nHits);
+  mCandidates.assign(mCellFirstHit.begin(), mCellFirstHit.end()-1);    // used here as next free position in each cell
+  for (int iHit=0; iHit<nHits; iHit++) mCellHits[mCandidates[mHitCell[iHit]]++] = iHit;
+
+}
+
+//====================================================================================================================================================
@@ -0,0 +1,75 @@
+#ifndef MIDTrackletBuilder_h
+#define MIDTrackletBuilder_h
+
+#include "TVector3.h"
+#include "TMath.h"
+
+#include <vector>
+#include <utility>
+
+#include "MIDTrackletSelector.h"
+
+using namespace std;
+
+// (smeared) hits of one MID layer, stored as columns
+
+struct MIDLayerHits_t {
+  std::vector<double> x, y, z;
+  std::vector<int> trackID;
+  int size() const { return int(x.size()); }
+  void clear() { x.clear(); y.clear(); z.clear(); trackID.clear(); }
+  void push_back(double xHit, double yHit, double zHit, int trackIDHit) {
+    x.push_back(xHit);
+    y.push_back(yHit);
+    z.push_back(zHit);
+    trackID.push_back(trackIDHit);
+  }
+};
+
+// Builds the MID tracklets of an event: the hits of the 2nd layer are bucketed in an (eta, phi) grid whose cells are as large as the
+// deltaEta/deltaPhi extent of the tracklet acceptance, so that each hit of the 1st layer only needs to be paired with the hits of the
+// 3x3 neighbouring cells. The candidate pairs are then passed in batches to the MIDTrackletSelector
+
+class MIDTrackletBuilder {
+
+public:
+  MIDTrackletBuilder(MIDTrackletSelector *selector);
+  ~MIDTrackletBuilder() = default;
+
+  // fills the list of selected tracklets, as pairs of indices (hit in layer 1, hit in layer 2), ordered as in a plain double loop
+  void BuildTracklets(const MIDLayerHits_t &hitsLayer1, const MIDLayerHits_t &hitsLayer2, std::vector<std::pair<int,int>> &tracklets, bool evalEta=kFALSE);
+
+  long GetNCandidatePairs() const { return mNCandidatePairs; }   // number of pairs passed to the selector in the last event
+  MIDTrackletSelector* GetSelector() const { return mSelector; }
+
+protected:
+
+  void FillGrid(const MIDLayerHits_t &hitsLayer2);
+  // eta cell index, bound to [-1, mNCellsEta] so that hits outside the grid get no neighbouring cell (or an irrelevant one)
+  int EtaCell(double eta) const { return int(TMath::Min(double(mNCellsEta), TMath::Max(-1., TMath::Floor((eta-mEtaMin)/mEventCellSizeEta)))); }
+  int PhiCell(double phi) const { return TMath::Min(mNCellsPhi-1, TMath::Max(0, int((phi+TMath::Pi())/mCellSizePhi))); }
+
+  MIDTrackletSelector *mSelector;
+  bool mIsGridEnabled;
+
+  double mCellSizeEta, mCellSizePhi;    // minimal cell sizes
+  double mEventCellSizeEta;             // eta cell size for the current event, possibly enlarged to bound the number of cells
+  double mEtaMin;
+  int mNCellsEta, mNCellsPhi;
+
+  std::vector<double> mEtaLayer2, mPhiLayer2;
+  std::vector<int> mHitCell;
+  std::vector<int> mCellFirstHit;       // hits of the cell iCell are mCellHits[mCellFirstHit[iCell]] ... mCellHits[mCellFirstHit[iCell+1]-1]
+  std::vector<int> mCellHits;
+  std::vector<int> mCandidates;
+
+  // candidate pairs, in the structure-of-arrays form of the batch selection
+  std::vector<double> mCandX1, mCandY1, mCandZ1, mCandX2, mCandY2, mCandZ2;
+  std::vector<std::pair<int,int>> mCandPairs;
+  std::vector<UChar_t> mCandMask;
+
+  long mNCandidatePairs;
+
+};
+
+#endif
@@ -14,6 +14,14 @@ MIDTrackletSelector::MIDTrackletSelector() {
 
   for (int iCharge=0; iCharge<kNChargeOptions; iCharge++) mTrackletAcc4D[iCharge] = NULL;
 
+  mDeltaEtaRange[0] = mDeltaEtaRange[1] = 0;
+  mDeltaPhiRange[0] = mDeltaPhiRange[1] = 0;
+
+  mSearchSpotRadius = 0.2;
+
+  mCountLookups = kFALSE;
+  ResetLookupCounters();
+
   mIsSelectorSetup = kFALSE;
 
 }
@@ -54,6 +62,17 @@ bool MIDTrackletSelector::Setup(const Char_t *nameInputFile = "muonTrackletAccep
   mMomMax = mTrackletAcc4D[kAllMuons]->GetAxis(3)->GetBinCenter(mTrackletAcc4D[kAllMuons]->GetAxis(3)->GetNbins());
   mMomMin = mTrackletAcc4D[kAllMuons]->GetAxis(3)->GetBinCenter(1);
 
+  // flattening the acceptance maps in dense bit tables, used for all the lookups
+
+  mTable2D.Book(2, mTrackletAcc4D[kAllMuons]);
+  mTable3D.Book(3, mTrackletAcc4D[kAllMuons]);
+  for (int iCharge=0; iCharge<kNChargeOptions; iCharge++) mTable4D[iCharge].Book(4, mTrackletAcc4D[iCharge]);
+
+  if (!(mTable2D.GetFilledRange(0, mDeltaEtaRange[0], mDeltaEtaRange[1])) ||
+      !(mTable2D.GetFilledRange(1, mDeltaPhiRange[0], mDeltaPhiRange[1]))) {
+    printf("WARNING: tracklet acceptance in file %s is empty, no tracklet will be selected\n",mInputFile->GetName());
+  }
+
   mIsSelectorSetup = kTRUE;
   
   printf("Setup of MIDTrackletSelector successfully completed\n");
@@ -63,116 +82,340 @@ bool MIDTrackletSelector::Setup(const Char_t *nameInputFile = "muonTrackletAccep
 
 //====================================================================================================================================================
 
-bool MIDTrackletSelector::IsMIDTrackletSelected(TVector3 posHitLayer1, TVector3 posHitLayer2, bool evalEta=kFALSE) {
+bool MIDTrackletSelector::IsMIDTrackletSelected(const TVector3 &posHitLayer1, const TVector3 &posHitLayer2, bool evalEta=kFALSE) {
 
   if (!mIsSelectorSetup) {
     printf("ERROR: MIDTrackletSelector not initialized\n");
     return kFALSE;
   }
 
-  if (posHitLayer1.Perp() > posHitLayer2.Perp()) {
-    TVector3 tmp = posHitLayer1;
-    posHitLayer1 = posHitLayer2;
-    posHitLayer2 = tmp;
+  double deltaEta, deltaPhi, eta, phi;
+  TrackletKinematics(posHitLayer1.X(), posHitLayer1.Y(), posHitLayer1.Z(),
+		     posHitLayer2.X(), posHitLayer2.Y(), posHitLayer2.Z(),
+		     deltaEta, deltaPhi, eta, phi);
+
+  bool selected = evalEta ? LookupAcc3D(deltaEta,deltaPhi,eta) : LookupAcc2D(deltaEta,deltaPhi);
+  CountLookup(selected ? kAccepted : kOutOfAcceptance);
+  return selected;
+
+}
+
+//====================================================================================================================================================
+
+bool MIDTrackletSelector::IsMIDTrackletSelectedWithSearchSpot(const TVector3 &posHitLayer1, const TVector3 &posHitLayer2, const TVector3 &posITStrackLayer1, bool evalEta=kFALSE) {
+
+  if (!mIsSelectorSetup) {
+    printf("ERROR: MIDTrackletSelector not initialized\n");
+    return kFALSE;
   }
 
-  
-  double deltaPhi = posHitLayer2.DeltaPhi(posHitLayer1);
-  double deltaEta = posHitLayer2.Eta() - posHitLayer1.Eta();
-  
-  if (evalEta) {
-    double eta = posHitLayer1.Eta();
-    if (abs(eta) > mEtaMax) return kFALSE;
-    return mTrackletAcc3D->GetBinContent(mTrackletAcc3D->FindBin(deltaEta,deltaPhi,eta));
+  double deltaEta, deltaPhi, eta, phi;
+  TrackletKinematics(posHitLayer1.X(), posHitLayer1.Y(), posHitLayer1.Z(),
+		     posHitLayer2.X(), posHitLayer2.Y(), posHitLayer2.Z(),
+		     deltaEta, deltaPhi, eta, phi);
+
+  if (!IsInSearchSpot(eta, phi, posITStrackLayer1.Eta(), posITStrackLayer1.Phi())) {
+    CountLookup(kOutOfSearchSpot);
+    return kFALSE;
   }
 
-  else return mTrackletAcc2D->GetBinContent(mTrackletAcc2D->FindBin(deltaEta,deltaPhi));
+  bool selected = evalEta ? LookupAcc3D(deltaEta,deltaPhi,eta) : LookupAcc2D(deltaEta,deltaPhi);
+  CountLookup(selected ? kAccepted : kOutOfAcceptance);
+  return selected;
 
-  return kFALSE;
+}
+
+//====================================================================================================================================================
+
+bool MIDTrackletSelector::IsMIDTrackletSelected(const TVector3 &posHitLayer1, const TVector3 &posHitLayer2, const TVector3 &trackITS, int charge=0) {
+
+  if (!mIsSelectorSetup) {
+    printf("ERROR: MIDTrackletSelector not initialized\n");
+    return kFALSE;
+  }
+
+  double deltaEta, deltaPhi, eta, phi;
+  TrackletKinematics(posHitLayer1.X(), posHitLayer1.Y(), posHitLayer1.Z(),
+		     posHitLayer2.X(), posHitLayer2.Y(), posHitLayer2.Z(),
+		     deltaEta, deltaPhi, eta, phi);
+
+  bool selected = LookupAcc4D(deltaEta, deltaPhi, trackITS.Eta(), trackITS.Mag(), charge);
+  CountLookup(selected ? kAccepted : kOutOfAcceptance);
+  return selected;
 
 }
 
 //====================================================================================================================================================
 
-bool MIDTrackletSelector::IsMIDTrackletSelectedWithSearchSpot(TVector3 posHitLayer1, TVector3 posHitLayer2, TVector3 posITStrackLayer1, bool evalEta=kFALSE) {
+bool MIDTrackletSelector::IsMIDTrackletSelectedWithSearchSpot(const TVector3 &posHitLayer1, const TVector3 &posHitLayer2, const TVector3 &trackITS, const TVector3 &posITStrackLayer1, int charge=0) {
 
   if (!mIsSelectorSetup) {
     printf("ERROR: MIDTrackletSelector not initialized\n");
     return kFALSE;
   }
 
-  if (posHitLayer1.Perp() > posHitLayer2.Perp()) {
-    TVector3 tmp = posHitLayer1;
-    posHitLayer1 = posHitLayer2;
-    posHitLayer2 = tmp;
+  double deltaEta, deltaPhi, eta, phi;
+  TrackletKinematics(posHitLayer1.X(), posHitLayer1.Y(), posHitLayer1.Z(),
+		     posHitLayer2.X(), posHitLayer2.Y(), posHitLayer2.Z(),
+		     deltaEta, deltaPhi, eta, phi);
+
+  if (!IsInSearchSpot(eta, phi, posITStrackLayer1.Eta(), posITStrackLayer1.Phi())) {
+    CountLookup(kOutOfSearchSpot);
+    return kFALSE;
   }
 
-  double deltaPhiITS = posITStrackLayer1.DeltaPhi(posHitLayer1);
-  double deltaEtaITS = posITStrackLayer1.Eta() - posHitLayer1.Eta();
-  
-  if (TMath::Sqrt(deltaPhiITS*deltaPhiITS + deltaEtaITS*deltaEtaITS) > 0.2) return kFALSE;
+  bool selected = LookupAcc4D(deltaEta, deltaPhi, trackITS.Eta(), trackITS.Mag(), charge);
+  CountLookup(selected ? kAccepted : kOutOfAcceptance);
+  return selected;
 
-  return IsMIDTrackletSelected(posHitLayer1, posHitLayer2, evalEta);
-  
 }
 
 //====================================================================================================================================================
 
-bool MIDTrackletSelector::IsMIDTrackletSelected(TVector3 posHitLayer1, TVector3 posHitLayer2, TVector3 trackITS, int charge=0) {
+void MIDTrackletSelector::SelectMIDTracklets(const MIDTrackletBatch_t &batch, UChar_t *mask, bool evalEta) const {
+
+  SelectBatch(batch, nullptr, mask, evalEta);
+
+}
+
+//====================================================================================================================================================
+
+void MIDTrackletSelector::SelectMIDTrackletsWithSearchSpot(const MIDTrackletBatch_t &batch, const TVector3 &posITStrackLayer1, UChar_t *mask, bool evalEta) const {
+
+  SelectBatch(batch, &posITStrackLayer1, mask, evalEta);
+
+}
+
+//====================================================================================================================================================
+
+void MIDTrackletSelector::SelectBatch(const MIDTrackletBatch_t &batch, const TVector3 *posITStrackLayer1, UChar_t *mask, bool evalEta) const {
 
   if (!mIsSelectorSetup) {
     printf("ERROR: MIDTrackletSelector not initialized\n");
-    return kFALSE;
+    std::fill(mask, mask+batch.n, 0);
+    return;
   }
 
-  if (posHitLayer1.Perp() > posHitLayer2.Perp()) {
-    TVector3 tmp = posHitLayer1;
-    posHitLayer1 = posHitLayer2;
-    posHitLayer2 = tmp;
+  const bool evalMom = (batch.px && batch.py && batch.pz);
+  const double etaITS = posITStrackLayer1 ? posITStrackLayer1->Eta() : 0.;
+  const double phiITS = posITStrackLayer1 ? posITStrackLayer1->Phi() : 0.;
+
+  // the batch is processed in chunks kept on the stack: a first pass computes the tracklet kinematics from the
+  // contiguous coordinate arrays, a second pass does the table lookups
+  double deltaEta[kBatchChunkSize], deltaPhi[kBatchChunkSize], eta[kBatchChunkSize], phi[kBatchChunkSize];
+
+  for (int first=0; first<batch.n; first+=kBatchChunkSize) {
+
+    const int n = TMath::Min(kBatchChunkSize, batch.n-first);
+    UChar_t *maskChunk = mask + first;
+
+    for (int i=0; i<n; i++) {
+      TrackletKinematics(batch.x1[first+i], batch.y1[first+i], batch.z1[first+i],
+			 batch.x2[first+i], batch.y2[first+i], batch.z2[first+i],
+			 deltaEta[i], deltaPhi[i], eta[i], phi[i]);
+    }
+
+    if (evalMom) {
+      for (int i=0; i<n; i++) {
+	const double px = batch.px[first+i], py = batch.py[first+i], pz = batch.pz[first+i];
+	const int charge = batch.charge ? batch.charge[first+i] : 0;
+	maskChunk[i] = LookupAcc4D(deltaEta[i], deltaPhi[i], PseudoRapidity(px,py,pz), TMath::Sqrt(px*px + py*py + pz*pz), charge);
+      }
+    }
+    else if (evalEta) {
+      for (int i=0; i<n; i++) maskChunk[i] = LookupAcc3D(deltaEta[i], deltaPhi[i], eta[i]);
+    }
+    else {
+      for (int i=0; i<n; i++) maskChunk[i] = LookupAcc2D(deltaEta[i], deltaPhi[i]);
+    }
+
+    if (mCountLookups) {
+      for (int i=0; i<n; i++) {
+	bool inSearchSpot = !posITStrackLayer1 || IsInSearchSpot(eta[i], phi[i], etaITS, phiITS);
+	CountLookup(!inSearchSpot ? kOutOfSearchSpot : (maskChunk[i] ? kAccepted : kOutOfAcceptance));
+	maskChunk[i] &= inSearchSpot;
+      }
+    }
+    else if (posITStrackLayer1) {
+      for (int i=0; i<n; i++) maskChunk[i] &= IsInSearchSpot(eta[i], phi[i], etaITS, phiITS);
+    }
+
   }
-  
-  double deltaPhi = posHitLayer2.DeltaPhi(posHitLayer1);
-  double deltaEta = posHitLayer2.Eta() - posHitLayer1.Eta();
-  double eta      = trackITS.Eta();
-  double mom      = trackITS.Mag();
-  
+
+}
+
+//====================================================================================================================================================
+
+double MIDTrackletSelector::PseudoRapidity(double x, double y, double z) {
+
+  double mag = TMath::Sqrt(x*x + y*y + z*z);
+  double cosTheta = (mag == 0.) ? 1. : z/mag;
+  if (cosTheta*cosTheta < 1) return -0.5*TMath::Log((1.0-cosTheta)/(1.0+cosTheta));
+  if (z == 0) return 0;
+  if (z > 0)  return 10e10;
+  else        return -10e10;
+
+}
+
+//====================================================================================================================================================
+
+double MIDTrackletSelector::DeltaPhi(double phi1, double phi2) {
+
+  double deltaPhi = phi1 - phi2;
+  while (deltaPhi >= TMath::Pi())  deltaPhi -= TMath::TwoPi();
+  while (deltaPhi < -TMath::Pi())  deltaPhi += TMath::TwoPi();
+  return deltaPhi;
+
+}
+
+//====================================================================================================================================================
+
+void MIDTrackletSelector::TrackletKinematics(double x1, double y1, double z1, double x2, double y2, double z2,
+					     double &deltaEta, double &deltaPhi, double &etaLayer1, double &phiLayer1) {
+
+  const double eta1 = PseudoRapidity(x1,y1,z1);
+  const double eta2 = PseudoRapidity(x2,y2,z2);
+  const double phi1 = Phi(x1,y1);
+  const double phi2 = Phi(x2,y2);
+
+  // the hit at smaller radius is taken as the one on the 1st layer
+  const bool swap = TMath::Sqrt(x1*x1 + y1*y1) > TMath::Sqrt(x2*x2 + y2*y2);
+
+  etaLayer1 = swap ? eta2 : eta1;
+  phiLayer1 = swap ? phi2 : phi1;
+  deltaEta  = (swap ? eta1 : eta2) - etaLayer1;
+  deltaPhi  = DeltaPhi(swap ? phi1 : phi2, phiLayer1);
+
+}
+
+//====================================================================================================================================================
+
+bool MIDTrackletSelector::LookupAcc2D(double deltaEta, double deltaPhi) const {
+
+  const int bin[2] = {mTable2D.axis[0].FindBin(deltaEta), mTable2D.axis[1].FindBin(deltaPhi)};
+  const long index = mTable2D.Index(bin);
+
+  return (index >= 0) && mTable2D.Test(index);
+
+}
+
+//====================================================================================================================================================
+
+bool MIDTrackletSelector::LookupAcc3D(double deltaEta, double deltaPhi, double eta) const {
+
+  if (abs(eta) > mEtaMax) return kFALSE;
+
+  const int bin[3] = {mTable3D.axis[0].FindBin(deltaEta), mTable3D.axis[1].FindBin(deltaPhi), mTable3D.axis[2].FindBin(eta)};
+  const long index = mTable3D.Index(bin);
+
+  return (index >= 0) && mTable3D.Test(index);
+
+}
+
+//====================================================================================================================================================
+
+bool MIDTrackletSelector::LookupAcc4D(double deltaEta, double deltaPhi, double eta, double mom, int charge) const {
+
   if (abs(eta) > mEtaMax) return kFALSE;
 
   if (mom > mMomMax) mom = mMomMax;
   if (mom < mMomMin) mom = mMomMin;
-  
-  double coord[4] = {deltaEta,deltaPhi,eta,mom};
-  
-  if      (charge > 0) return mTrackletAcc4D[kMuonPlus] ->GetBinContent(mTrackletAcc4D[kMuonPlus] ->GetBin(coord));
-  else if (charge < 0) return mTrackletAcc4D[kMuonMinus]->GetBinContent(mTrackletAcc4D[kMuonMinus]->GetBin(coord));
-  else                 return mTrackletAcc4D[kAllMuons] ->GetBinContent(mTrackletAcc4D[kAllMuons] ->GetBin(coord));
-  
-  return kFALSE;
-  
+
+  const AccTable_t &table = (charge > 0) ? mTable4D[kMuonPlus] : ((charge < 0) ? mTable4D[kMuonMinus] : mTable4D[kAllMuons]);
+
+  const int bin[4] = {table.axis[0].FindBin(deltaEta), table.axis[1].FindBin(deltaPhi), table.axis[2].FindBin(eta), table.axis[3].FindBin(mom)};
+  const long index = table.Index(bin);
+
+  return (index >= 0) && table.Test(index);
+
 }
 
 //====================================================================================================================================================
 
-bool MIDTrackletSelector::IsMIDTrackletSelectedWithSearchSpot(TVector3 posHitLayer1, TVector3 posHitLayer2, TVector3 trackITS, TVector3 posITStrackLayer1, int charge=0) {
+bool MIDTrackletSelector::IsInSearchSpot(double etaLayer1, double phiLayer1, double etaITS, double phiITS) const {
 
-  if (!mIsSelectorSetup) {
-    printf("ERROR: MIDTrackletSelector not initialized\n");
-    return kFALSE;
+  double deltaPhiITS = DeltaPhi(phiITS, phiLayer1);
+  double deltaEtaITS = etaITS - etaLayer1;
+
+  return (TMath::Sqrt(deltaPhiITS*deltaPhiITS + deltaEtaITS*deltaEtaITS) <= mSearchSpotRadius);
+
+}
+
+//====================================================================================================================================================
+
+void MIDTrackletSelector::AccAxis_t::Set(const TAxis *axis) {
+
+  nBins = axis->GetNbins();
+  xMin  = axis->GetXmin();
+  xMax  = axis->GetXmax();
+
+  edges.clear();
+  if (axis->GetXbins()->GetSize()) {
+    for (int iBin=1; iBin<=nBins+1; iBin++) edges.push_back(axis->GetBinLowEdge(iBin));
+  }
+
+}
+
+//====================================================================================================================================================
+
+void MIDTrackletSelector::AccTable_t::Book(int nDimensions, THnSparse *hist) {
+
+  // a bin of the table is set if any bin of the THnSparse projected on it has a non-zero content
+
+  nDim = nDimensions;
+
+  long nBinsTot = 1;
+  for (int iDim=0; iDim<nDim; iDim++) {
+    axis[iDim].Set(hist->GetAxis(iDim));
+    nBinsTot *= axis[iDim].nBins;
+  }
+  bits.assign((nBinsTot+31)/32, 0);
+
+  std::vector<Int_t> coord(hist->GetNdimensions());
+  int bin[4];
+
+  for (Long64_t iBin=0; iBin<hist->GetNbins(); iBin++) {
+    if (hist->GetBinContent(iBin, coord.data()) == 0) continue;
+    bool inRange = kTRUE;
+    for (int iDim=0; iDim<nDim; iDim++) {
+      bin[iDim] = coord[iDim] - 1;    // skipping underflow and overflow bins
+      if (bin[iDim] < 0 || bin[iDim] >= axis[iDim].nBins) inRange = kFALSE;
+    }
+    if (inRange) Set(Index(bin));
   }
 
-  if (posHitLayer1.Perp() > posHitLayer2.Perp()) {
-    TVector3 tmp = posHitLayer1;
-    posHitLayer1 = posHitLayer2;
-    posHitLayer2 = tmp;
+}
+
+//====================================================================================================================================================
+
+bool MIDTrackletSelector::AccTable_t::GetFilledRange(int iDim, double &xMin, double &xMax) const {
+
+  // range covered along the axis iDim by the bins set in the table. Returns kFALSE if the table is empty
+
+  long stride = 1, nBinsTot = 1;
+  for (int jDim=0; jDim<nDim; jDim++) {
+    if (jDim > iDim) stride *= axis[jDim].nBins;
+    nBinsTot *= axis[jDim].nBins;
   }
 
-  double deltaPhiITS = posITStrackLayer1.DeltaPhi(posHitLayer1);
-  double deltaEtaITS = posITStrackLayer1.Eta() - posHitLayer1.Eta();
-  
-  if (TMath::Sqrt(deltaPhiITS*deltaPhiITS + deltaEtaITS*deltaEtaITS) > 0.2) return kFALSE;
+  int binMin = axis[iDim].nBins, binMax = -1;
+
+  for (long index=0; index<nBinsTot; index++) {
+    if (!Test(index)) continue;
+    int bin = (index / stride) % axis[iDim].nBins;
+    if (bin < binMin) binMin = bin;
+    if (bin > binMax) binMax = bin;
+  }
+
+  if (binMax < 0) {
+    xMin = xMax = 0;
+    return kFALSE;
+  }
+
+  xMin = axis[iDim].GetBinLowEdge(binMin);
+  xMax = axis[iDim].GetBinLowEdge(binMax+1);
+  return kTRUE;
 
-  return IsMIDTrackletSelected(posHitLayer1, posHitLayer2, trackITS, charge);
-    
 }
 
 //====================================================================================================================================================
@@ -8,39 +8,132 @@
 #include "TVector3.h"
 #include "TMath.h"
 
+#include <vector>
+#include <algorithm>
+
 using namespace std;
 
+// Structure-of-arrays input for the batch selection: the i-th candidate is the pair of hits (x1[i],y1[i],z1[i]) and (x2[i],y2[i],z2[i]).
+// If the ITS momentum columns are given, the 4D (deltaEta, deltaPhi, eta, p) acceptance is evaluated, for the charge given in the
+// charge column (or for all muons if the charge column is not given)
+
+struct MIDTrackletBatch_t {
+  int n = 0;
+  const double *x1 = nullptr, *y1 = nullptr, *z1 = nullptr;    // hits on the 1st MID layer
+  const double *x2 = nullptr, *y2 = nullptr, *z2 = nullptr;    // hits on the 2nd MID layer
+  const double *px = nullptr, *py = nullptr, *pz = nullptr;    // (optional) momentum of the ITS track
+  const int    *charge = nullptr;                              // (optional) charge of the ITS track
+};
+
 class MIDTrackletSelector {
-  
+
 public:
   MIDTrackletSelector();
   ~MIDTrackletSelector() = default;
 
   enum { kMuonMinus, kMuonPlus, kAllMuons, kNChargeOptions };
-  
+
   bool Setup(const Char_t *nameInputFile);
   bool IsSelectorSetup() { return mIsSelectorSetup; }
-  bool IsMIDTrackletSelected(TVector3 posHitLayer1, TVector3 posHitLayer2, bool evalEta);
-  bool IsMIDTrackletSelected(TVector3 posHitLayer1, TVector3 posHitLayer2, TVector3 trackITS, int charge);
-  bool IsMIDTrackletSelectedWithSearchSpot(TVector3 posHitLayer1, TVector3 posHitLayer2, TVector3 posITStrackLayer1, bool evalEta);
-  bool IsMIDTrackletSelectedWithSearchSpot(TVector3 posHitLayer1, TVector3 posHitLayer2, TVector3 trackITS, TVector3 posITStrackLayer1, int charge);
+  bool IsMIDTrackletSelected(const TVector3 &posHitLayer1, const TVector3 &posHitLayer2, bool evalEta);
+  bool IsMIDTrackletSelected(const TVector3 &posHitLayer1, const TVector3 &posHitLayer2, const TVector3 &trackITS, int charge);
+  bool IsMIDTrackletSelectedWithSearchSpot(const TVector3 &posHitLayer1, const TVector3 &posHitLayer2, const TVector3 &posITStrackLayer1, bool evalEta);
+  bool IsMIDTrackletSelectedWithSearchSpot(const TVector3 &posHitLayer1, const TVector3 &posHitLayer2, const TVector3 &trackITS, const TVector3 &posITStrackLayer1, int charge);
+
+  // batch versions: mask[i] is set to 1 if the i-th candidate of the batch is selected, to 0 otherwise
+  void SelectMIDTracklets(const MIDTrackletBatch_t &batch, UChar_t *mask, bool evalEta=kFALSE) const;
+  void SelectMIDTrackletsWithSearchSpot(const MIDTrackletBatch_t &batch, const TVector3 &posITStrackLayer1, UChar_t *mask, bool evalEta=kFALSE) const;
+
+  // same as TVector3::PseudoRapidity, TVector3::Phi and TVector3::DeltaPhi, without building the vectors
+  static double PseudoRapidity(double x, double y, double z);
+  static double Phi(double x, double y) { return (x == 0. && y == 0.) ? 0. : TMath::ATan2(y,x); }
+  static double DeltaPhi(double phi1, double phi2);
+
+  // extent of the (deltaEta, deltaPhi) region with non-zero acceptance
+  void GetDeltaEtaRange(double &deltaEtaMin, double &deltaEtaMax) const { deltaEtaMin = mDeltaEtaRange[0]; deltaEtaMax = mDeltaEtaRange[1]; }
+  void GetDeltaPhiRange(double &deltaPhiMin, double &deltaPhiMax) const { deltaPhiMin = mDeltaPhiRange[0]; deltaPhiMax = mDeltaPhiRange[1]; }
+
+  // radius, in the (eta, phi) plane, of the search spot around the extrapolation of the ITS track at the 1st MID layer
+  void SetSearchSpotRadius(double radius) { mSearchSpotRadius = radius; }
+  double GetSearchSpotRadius() const      { return mSearchSpotRadius; }
+
+  // lookup statistics of all the selection methods, counted only when enabled: each lookup is either accepted or rejected because the
+  // tracklet is out of the search spot (checked first) or out of the acceptance
+  enum { kLookups, kAccepted, kOutOfSearchSpot, kOutOfAcceptance, kNLookupCounters };
+  void EnableLookupCounters(bool enable = kTRUE) { mCountLookups = enable; }
+  void ResetLookupCounters() { std::fill(mLookupCounters, mLookupCounters+kNLookupCounters, 0L); }
+  long GetLookupCounter(int iCounter) const { return mLookupCounters[iCounter]; }
 
   TH2C* GetAcc2D()                { return mTrackletAcc2D; }
   TH3C* GetAcc3D()                { return mTrackletAcc3D; }
   THnSparse* GetAcc4D(int charge) { return mTrackletAcc4D[charge]; }
-  
+
 protected:
-  
+
+  // dense copy of an axis of the acceptance maps. Bins are counted from 0, -1 means out of the axis range
+  struct AccAxis_t {
+    int nBins = 0;
+    double xMin = 0, xMax = 0;
+    std::vector<double> edges;     // only filled for variable bin sizes
+    void Set(const TAxis *axis);
+    double GetBinLowEdge(int bin) const { return edges.empty() ? xMin + bin*(xMax-xMin)/nBins : edges[bin]; }
+    int FindBin(double x) const {
+      if (!(x >= xMin && x < xMax)) return -1;
+      if (edges.empty()) {
+	int bin = int(nBins*(x-xMin)/(xMax-xMin));    // same arithmetic as TAxis::FindBin
+	return bin < nBins ? bin : nBins-1;
+      }
+      return int(std::upper_bound(edges.begin(), edges.end(), x) - edges.begin()) - 1;
+    }
+  };
+
+  // acceptance map flattened in a bit table, with the last axis running fastest
+  struct AccTable_t {
+    int nDim = 0;
+    AccAxis_t axis[4];
+    std::vector<UInt_t> bits;
+    void Book(int nDimensions, THnSparse *hist);
+    bool GetFilledRange(int iDim, double &xMin, double &xMax) const;
+    void Set(long index) { bits[index>>5] |= (1u << (index&31)); }
+    bool Test(long index) const { return (bits[index>>5] >> (index&31)) & 1u; }
+    long Index(const int *bin) const {
+      long index = 0;
+      for (int iDim=0; iDim<nDim; iDim++) {
+	if (bin[iDim] < 0) return -1;
+	index = index*axis[iDim].nBins + bin[iDim];
+      }
+      return index;
+    }
+  };
+
+  // kinematics of a tracklet, with the hits ordered by increasing radius as done by the per-pair methods
+  static void TrackletKinematics(double x1, double y1, double z1, double x2, double y2, double z2,
+				 double &deltaEta, double &deltaPhi, double &etaLayer1, double &phiLayer1);
+
+  bool LookupAcc2D(double deltaEta, double deltaPhi) const;
+  bool LookupAcc3D(double deltaEta, double deltaPhi, double eta) const;
+  bool LookupAcc4D(double deltaEta, double deltaPhi, double eta, double mom, int charge) const;
+  bool IsInSearchSpot(double etaLayer1, double phiLayer1, double etaITS, double phiITS) const;
+  void SelectBatch(const MIDTrackletBatch_t &batch, const TVector3 *posITStrackLayer1, UChar_t *mask, bool evalEta) const;
+  void CountLookup(int outcome) const { if (mCountLookups) { mLookupCounters[kLookups]++; mLookupCounters[outcome]++; } }
+
+  static const int kBatchChunkSize = 256;
+
   TFile *mInputFile;
   TH3C *mTrackletAcc3D;
   TH2C *mTrackletAcc2D;
   THnSparse *mTrackletAcc4D[kNChargeOptions];
+  AccTable_t mTable2D, mTable3D, mTable4D[kNChargeOptions];
   bool mIsSelectorSetup;
   double mEtaMax;
   double mMomMax;
   double mMomMin;
+  double mDeltaEtaRange[2];
+  double mDeltaPhiRange[2];
+  double mSearchSpotRadius;
+  bool mCountLookups;
+  mutable long mLookupCounters[kNLookupCounters];
 
 };
 
 #endif
-
@@ -2,5 +2,12 @@
 # Jpsi_ptdep_Pyhia8monash_pp14p0_absy1p44
 # Lambda_c_ptdep_Pyhia8mode2_pp14p0_absy1p44
 
+# CASE can be a comma-separated list, e.g.
+# Lambda_c_ptdep_Pyhia8mode2_pp14p0_absy1p44,Xicc_ptdep_Pyhia8mode2_pp14p0_absy1p44,Omegaccc_ptdep_Pyhia8mode2_pp14p0_absy1p44
+# cases with the same generator settings are generated in a single pass
+
 CASE=x3872_ptdep_Pyhia8monash_pp14p0_absy1p44
 OUTPUTFOLDER=outputtest
+NJOBS=50 #WITH NJOBS>1 EACH JOB WRITES UNNORMALIZED HISTOGRAMS, NORMALIZED BY merge.sh
+NTHREADS=1 #THREADS PER JOB, EACH WITH ITS OWN PYTHIA INSTANCE
+BASESEED=12345 #JOB i RUNS WITH SEED BASESEED+i, THE SEEDS OF ITS THREADS ARE DERIVED FROM IT
@@ -1,5 +1,5 @@
 g++ ${1}.cc \
- -O2 -ansi -W -Wall -std=c++11 -Wshadow -m64 -Wno-shadow \
+ -O2 -ansi -W -Wall -std=c++11 -pthread -Wshadow -m64 -Wno-shadow \
  -o ${1}.exe \
      -I$PY8_HEPMC3_INCLUDE -L$PY8_HEPMC3_LIB -lHepMC3\
          -I$PY8_PYTHIA8_INCLUDE -L$PY8_PYTHIA8_LIB -lpythia8 \
@@ -38,46 +38,69 @@
 //include <stdio.h>
 //include <glib.h>
 #include <yaml-cpp/yaml.h>
+#include <thread>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include "hadronhistos.h"
 
 using namespace Pythia8;
 
-int main(int argc, char* argv[]) {
-    (void)argc;
-    std::string mycase = argv[1];
-    int cislo = -1;                 //unique number for each file
-    cislo = atoi(argv[2]);
-    // number of parallel jobs to be run. Be aware that each single file
-    // will be normalized by this number to make sure that the merged output
-    // file has the proper normalization!
-    int n_jobs = -1;
-    n_jobs = atoi(argv[3]);
+// seed of the Pythia instance of thread ithread. Thread 0 keeps the seed of the job, so that single-threaded runs
+// reproduce the former event samples, the other ones are hashed from it (splitmix64) into the range accepted by Pythia
+int ThreadSeed(int seed, int ithread) {
+    if (ithread == 0) return seed;
+    uint64_t z = (uint64_t(seed) << 32) + ithread;
+    z += 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return 1 + int(z % 899999999ULL);
+}
 
-    YAML::Node node = YAML::LoadFile("config.yaml");
-    YAML::Node nodecase = node[mycase.data()];
+// charm enrichment for rare multi-charm hadrons: the events with fewer than mincharmquarks charm quarks (and fewer
+// antiquarks) at the end of the parton level are kept with probability nocharmkeepfraction only, and the kept ones get
+// the weight 1/nocharmkeepfraction. The hadronisation and decays of most of the events which can't contain the hadron
+// of interest are saved, without biasing the spectra
+class CharmEnrichmentHook : public UserHooks {
+
+public:
+    CharmEnrichmentHook(int mincharmquarks, double nocharmkeepfraction)
+      : fMinCharmQuarks(mincharmquarks), fKeepFraction(nocharmkeepfraction), fWeight(1) {}
+
+    bool canVetoPartonLevel() override { return true; }
+
+    bool doVetoPartonLevel(const Event &event) override {
+        fWeight = 1;
+        int ncharm = 0, nanticharm = 0;
+        for (int i = 0; i < event.size(); ++i) {
+            if (!event[i].isFinal()) continue;
+            if (event[i].id() == 4) ++ncharm;
+            else if (event[i].id() == -4) ++nanticharm;
+        }
+        if (std::max(ncharm, nanticharm) >= fMinCharmQuarks) return false;
+        if (rndmPtr->flat() >= fKeepFraction) return true;
+        fWeight = 1./fKeepFraction;
+        return false;
+    }
+
+    // enrichment weight of the last event
+    double weight() const { return fWeight; }
 
-    const std::string myhadronname = nodecase["myhadronname"].as<std::string>();
-    const std::string myhadronlatex = nodecase["myhadronlatex"].as<std::string>();
-    int pdgparticle = nodecase["pdgparticle"].as<int>();
-    float correction = nodecase["correction"].as<float>();
-    int maxnevents = nodecase["maxneventsperjob"].as<int>();
+private:
+    int fMinCharmQuarks;
+    double fKeepFraction;
+    double fWeight;
+};
+
+void ConfigurePythia(Pythia &pythia, const YAML::Node &nodecase, int maxnevents, int seed) {
     int tune = nodecase["tune"].as<int>();
     int beamidA = nodecase["beamidA"].as<int>();
     int beamidB = nodecase["beamidB"].as<int>();
     float eCM = nodecase["eCM"].as<float>();
     const std::string pythiamode = nodecase["pythiamode"].as<std::string>();
-    const std::string outputfile = nodecase["outputfile"].as<std::string>();
-    double nptbins = nodecase["nptbins"].as<int>();
-    double ptmin = nodecase["ptmin"].as<float>();
-    double ptmax = nodecase["ptmax"].as<float>();
-    double ymin = nodecase["ymin"].as<float>();
-    double ymax = nodecase["ymax"].as<float>();
     const std::string extramode = nodecase["extramode"].as<std::string>();
 
-    //END OF CONFIGURATION
-
-
-    // Generator. Process selection. LHC initialization. Histogram.
-    Pythia pythia;
     pythia.readString(Form("%s", pythiamode.data()));
     pythia.readString(Form("Main:numberOfEvents = %d", maxnevents));
     pythia.readString("Next:numberShowEvent = 0");
@@ -87,7 +110,14 @@ int main(int argc, char* argv[]) {
     pythia.readString(Form("Beams:eCM = %f", eCM));
 
     pythia.readString("Random:setSeed = on");
-    pythia.readString(Form("Random:seed = %d",cislo));
+    pythia.readString(Form("Random:seed = %d",seed));
+
+    // pT-hat biasing of the 2 -> 2 hard processes, the events get weights returned by info.weight()
+    if (nodecase["bias2selectionpow"]) {
+        pythia.readString("PhaseSpace:bias2Selection = on");
+        pythia.readString(Form("PhaseSpace:bias2SelectionPow = %f", nodecase["bias2selectionpow"].as<float>()));
+        pythia.readString(Form("PhaseSpace:bias2SelectionRef = %f", nodecase["bias2selectionref"].as<float>()));
+    }
 
     if (extramode=="mode2") {
         std::cout<<"Running with mode2"<<std::endl;
@@ -108,77 +138,237 @@ int main(int argc, char* argv[]) {
         pythia.readString("BeamRemnants:remnantMode = 1");
         pythia.readString("BeamRemnants:saturation =5");
     }
-    pythia.init();
-
-    TFile *fout = new TFile(outputfile.data(), "recreate");
-
-    fout->cd();
-    TH1F*hparticlept = new TH1F("hchargedparticles_pt", ";p_{T};charged particle dN/dp_{T}", nptbins, ptmin, ptmax);
-    TH1F*hptyields_unnorm = new TH1F(Form("h%syieldsvspt_unnorm", myhadronname.data()), ";p_{T} (GeV);unnormalized yield (particle+anti)", nptbins, ptmin, ptmax);
-    TH1F*hptcross = new TH1F(Form("h%scrossvspt", myhadronname.data()), Form(";p_{T} (GeV);%s d#sigma^{PYTHIA}/dp_{T} (#mu b/GeV)", myhadronlatex.data()), nptbins, ptmin, ptmax);
-    TH1F*hycharmcross = new TH1F("hycharmcross", ";y;%s d#sigma_{c}^{PYTHIA}/dy (#mu b)", 61, -30.5, 30.5);
-    TH1F*hycross = new TH1F("hycross", ";y;%s d#sigma_{HF}^{PYTHIA}/dy (#mu b)", 61, -30.5, 30.5);
-    TH2F*hptycharmcross = new TH2F("hptcharmcross", ";p_{T} (GeV); y", 100, 0., 100.,60, -30., 30.);
-
-    // Begin event loop. Generate event. Skip if error. List first one.
-    int nmyhadron = 0;
-    for (int iEvent = 0; iEvent < maxnevents; ++iEvent) {
-
-        pythia.next();
-
-        for (int i = 0; i < pythia.event.size(); ++i) {
-            if(pythia.event[i].pT()<0 || pythia.event[i].pT()>1.e+5) continue;
-            if(pythia.event[i].idAbs()==4) {
-		hycharmcross->Fill(pythia.event[i].y());
-	        hptycharmcross->Fill(pythia.event[i].pT(), pythia.event[i].y());
-	    }
-	    if(pythia.event[i].idAbs()==pdgparticle){
-		hycross->Fill(pythia.event[i].y());
-	    }
-	    if(pythia.event[i].y()<ymin || pythia.event[i].y()>ymax) continue;
-
-            hparticlept->Fill(pythia.event[i].pT());
-            if(pythia.event[i].idAbs()==pdgparticle) {
-                ++nmyhadron;
-                hptyields_unnorm->Fill(pythia.event[i].pT());
+}
+
+// settings of one case of config.yaml, apart from the generator ones
+struct HadronCase_t {
+    std::string name;
+    std::string myhadronname;
+    std::string myhadronlatex;
+    std::string outputfile;
+    int pdgparticle;
+    float correction;
+    int maxnevents;
+    int nptbins;
+    double ptmin, ptmax, ymin, ymax;
+
+    HadronCase_t(const std::string &mycase, const YAML::Node &nodecase) {
+        name = mycase;
+        myhadronname = nodecase["myhadronname"].as<std::string>();
+        myhadronlatex = nodecase["myhadronlatex"].as<std::string>();
+        outputfile = nodecase["outputfile"].as<std::string>();
+        pdgparticle = nodecase["pdgparticle"].as<int>();
+        correction = nodecase["correction"].as<float>();
+        maxnevents = nodecase["maxneventsperjob"].as<int>();
+        nptbins = nodecase["nptbins"].as<int>();
+        ptmin = nodecase["ptmin"].as<float>();
+        ptmax = nodecase["ptmax"].as<float>();
+        ymin = nodecase["ymin"].as<float>();
+        ymax = nodecase["ymax"].as<float>();
+    }
+};
+
+// cases sharing the generator settings, generated in a single pass
+struct GeneratorGroup_t {
+    YAML::Node nodecase;                      // settings of the first case of the group
+    std::vector<int> cases;                   // indices in the list of cases
+    int maxnevents = 0;                       // largest maxneventsperjob of the group
+};
+
+std::string GeneratorKey(const YAML::Node &nodecase) {
+    std::string key;
+    const char *settings[] = {"pythiamode", "tune", "beamidA", "beamidB", "eCM", "extramode"};
+    for (const char *setting : settings) key += nodecase[setting].as<std::string>() + "|";
+    const char *weightsettings[] = {"bias2selectionpow", "bias2selectionref", "mincharmquarks", "nocharmkeepfraction"};
+    for (const char *setting : weightsettings) key += (nodecase[setting] ? nodecase[setting].as<std::string>() : std::string("-")) + "|";
+    return key;
+}
+
+// event loop of one thread, filling the histograms of the thread only. Each particle is dispatched
+// to the histograms of the cases of its PDG code through the lookup table pdgToCases. The histograms are filled
+// with the Pythia event weight times the charm-enrichment weight, whose sums are accumulated in sumw[0] and sumw[1]
+void GenerateEvents(Pythia *pythia, const CharmEnrichmentHook *enrichment, int nevents, const std::vector<HadronCase_t> *cases,
+                    const std::map<int, std::vector<int>> *pdgToCases, std::vector<HadronHistos_t> *histos, std::vector<long> *nmyhadrons,
+                    double *sumw) {
+
+    const int ncases = cases->size();
+    for (int iEvent = 0; iEvent < nevents; ++iEvent) {
+
+        if (!pythia->next()) continue;
+
+        const double w = pythia->info.weight()*(enrichment ? enrichment->weight() : 1.);
+        sumw[0] += w;
+        sumw[1] += w*w;
+
+        const Event &event = pythia->event;
+        for (int i = 0; i < event.size(); ++i) {
+            const double pT = event[i].pT();
+            if(pT<0 || pT>1.e+5) continue;
+            const double y = event[i].y();
+            if(event[i].idAbs()==4) {
+                for (int icase = 0; icase < ncases; ++icase) {
+                    (*histos)[icase].hycharmcross->Fill(y, w);
+                    (*histos)[icase].hptycharmcross->Fill(pT, y, w);
+                }
+            }
+            for (int icase = 0; icase < ncases; ++icase) {
+                if(y<(*cases)[icase].ymin || y>(*cases)[icase].ymax) continue;
+                (*histos)[icase].hparticlept->Fill(pT, w);
+            }
+            auto found = pdgToCases->find(event[i].idAbs());
+            if (found == pdgToCases->end()) continue;
+            for (int icase : found->second) {
+                HadronHistos_t &h = (*histos)[icase];
+                h.hycross->Fill(y, w);
+                if(y<(*cases)[icase].ymin || y>(*cases)[icase].ymax) continue;
+                ++(*nmyhadrons)[icase];
+                h.hptyields_unnorm->Fill(pT, w);
+                h.hptcross->Fill(pT, w);
+            }
+        }
+    }
+}
+
+// generates the events of one group of cases with n_threads Pythia instances and returns the merged histograms of each case
+std::vector<HadronHistos_t> GenerateGroup(const GeneratorGroup_t &group, const std::vector<HadronCase_t> &allcases, int seed, int n_threads) {
+
+    std::vector<HadronCase_t> cases;
+    std::map<int, std::vector<int>> pdgToCases;
+    for (int icase : group.cases) {
+        pdgToCases[std::abs(allcases[icase].pdgparticle)].push_back(cases.size());
+        cases.push_back(allcases[icase]);
+    }
+    const int ncases = cases.size();
+
+    // Generators, one per thread, initialised one after the other to keep the logs readable
+    std::vector<std::unique_ptr<Pythia>> pythias;
+    std::vector<std::shared_ptr<CharmEnrichmentHook>> enrichments(n_threads);
+    for (int ithread = 0; ithread < n_threads; ++ithread) {
+        pythias.emplace_back(new Pythia());
+        ConfigurePythia(*pythias.back(), group.nodecase, group.maxnevents, ThreadSeed(seed, ithread));
+        if (group.nodecase["mincharmquarks"]) {
+            enrichments[ithread] = std::make_shared<CharmEnrichmentHook>(group.nodecase["mincharmquarks"].as<int>(), group.nodecase["nocharmkeepfraction"].as<double>());
+#if PYTHIA_VERSION_INTEGER >= 8300
+            pythias.back()->setUserHooksPtr(enrichments[ithread]);
+#else
+            pythias.back()->setUserHooksPtr(enrichments[ithread].get());
+#endif
+        }
+        if (!pythias.back()->init()) {
+            printf("Pythia initialisation failed for thread %d\n", ithread);
+            return std::vector<HadronHistos_t>();
+        }
+    }
+
+    // per-thread histograms, kept out of the ROOT directories since they are filled concurrently
+    std::vector<std::vector<HadronHistos_t>> histos(n_threads, std::vector<HadronHistos_t>(ncases));
+    std::vector<std::vector<long>> nmyhadrons(n_threads, std::vector<long>(ncases, 0));
+    std::vector<std::vector<double>> sumw(n_threads, std::vector<double>(2, 0.));
+    for (int ithread = 0; ithread < n_threads; ++ithread) {
+        for (int icase = 0; icase < ncases; ++icase) {
+            const HadronCase_t &c = cases[icase];
+            histos[ithread][icase].book(c.myhadronname, c.myhadronlatex, c.nptbins, c.ptmin, c.ptmax);
+        }
+    }
+
+    // Begin event loop. The events of the job are shared among the threads
+    std::vector<std::thread> threads;
+    for (int ithread = 0; ithread < n_threads; ++ithread) {
+        int nevents = long(group.maxnevents)*(ithread+1)/n_threads - long(group.maxnevents)*ithread/n_threads;
+        threads.emplace_back(GenerateEvents, pythias[ithread].get(), enrichments[ithread].get(), nevents, &cases, &pdgToCases, &histos[ithread], &nmyhadrons[ithread], sumw[ithread].data());
+    }
+    for (auto &thread : threads) thread.join();
+
+    // merging in thread order
+    std::vector<HadronHistos_t> &merged = histos[0];
+    for (int ithread = 0; ithread < n_threads; ++ithread) {
+        pythias[ithread]->stat();
+        const Info &info = pythias[ithread]->info;
+        for (int icase = 0; icase < ncases; ++icase) {
+            merged[icase].addGenerator(info.sigmaGen(), info.weightSum(), info.nAccepted(), info.nTried(), sumw[ithread][0], sumw[ithread][1]);
+            if (ithread > 0) {
+                merged[icase].add(histos[ithread][icase]);
+                nmyhadrons[0][icase] += nmyhadrons[ithread][icase];
             }
-            // End of event loop. Statistics. Histogram. Done.
         }
     }
-    pythia.stat();
-    int nbinspT=hptcross->GetNbinsX();
-    double norm_fact = correction*pythia.info.sigmaGen()*1000/(2*n_jobs*pythia.info.nAccepted());
-    printf("norm fact %f\n", norm_fact);
-    double contentmyhadron[nbinspT], binwidthmyhadron[nbinspT];
-
-    for(int ibin=0; ibin < nbinspT; ibin++) {
-        contentmyhadron[ibin] = hptyields_unnorm->GetBinContent(ibin);
-        binwidthmyhadron[ibin]= hptyields_unnorm->GetBinWidth(ibin);
-        printf("bin %d, Content %f, binwidth %f\n",ibin, contentmyhadron[ibin], binwidthmyhadron[ibin]);
-        hptcross ->SetBinContent(ibin, contentmyhadron[ibin]*norm_fact/binwidthmyhadron[ibin]);
+    for (int icase = 0; icase < ncases; ++icase) {
+        printf("%s: N myhadron %ld\n", cases[icase].name.data(), nmyhadrons[0][icase]);
+        merged[icase].printSummary(cases[icase].name.data());
+    }
+    return merged;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s <case[,case2,...]> <seed> <n_jobs> [n_threads]\n", argv[0]);
+        return 1;
     }
-    const int nbinx = hptycharmcross->GetNbinsX();
-    const int nbiny = hptycharmcross->GetNbinsY();
-
-    double contentmyhadronxy[nbinx][nbinx];
-    double binwidthmyhadronxy[nbinx][nbinx];
-    for(int ibinx=0; ibinx < nbinx; ibinx++){
-        for(int ibiny=0; ibiny < nbiny; ibiny++){
-            contentmyhadronxy[ibinx][ibiny] = hptycharmcross->GetBinContent(ibinx+1, ibiny+1);
-            binwidthmyhadronxy[ibinx][ibiny]= hptycharmcross->GetXaxis()->GetBinWidth(ibinx+1)*hptycharmcross->GetYaxis()->GetBinWidth(ibiny+1);
-            hptycharmcross->SetBinContent(ibinx+1, ibiny+1, contentmyhadronxy[ibinx][ibiny]*norm_fact/binwidthmyhadronxy[ibinx][ibiny]);
+    // comma-separated list of cases. Cases with the same generator settings are generated together
+    std::string mycases = argv[1];
+    int cislo = -1;                 //unique number for each job, seeds of the threads are derived from it
+    cislo = atoi(argv[2]);
+    // number of parallel jobs to be run. With more than one job the histograms are written
+    // unnormalised together with the weight sums, and mergehadron normalises the merged output
+    int n_jobs = -1;
+    n_jobs = atoi(argv[3]);
+    // number of threads of this job, each with its own Pythia instance
+    int n_threads = 1;
+    if (argc > 4) n_threads = std::max(1, atoi(argv[4]));
+
+    YAML::Node node = YAML::LoadFile("config.yaml");
+
+    std::vector<HadronCase_t> cases;
+    std::vector<GeneratorGroup_t> groups;
+    std::map<std::string, int> keyToGroup;
+    std::stringstream caselist(mycases);
+    std::string mycase;
+    while (std::getline(caselist, mycase, ',')) {
+        if (mycase.empty()) continue;
+        YAML::Node nodecase = node[mycase.data()];
+        if (!nodecase) {
+            printf("Case %s not found in config.yaml\n", mycase.data());
+            return 1;
+        }
+        cases.push_back(HadronCase_t(mycase, nodecase));
+        std::string key = GeneratorKey(nodecase);
+        if (keyToGroup.find(key) == keyToGroup.end()) {
+            keyToGroup[key] = groups.size();
+            groups.push_back(GeneratorGroup_t());
+            groups.back().nodecase = nodecase;
+        }
+        GeneratorGroup_t &group = groups[keyToGroup[key]];
+        group.cases.push_back(cases.size()-1);
+        group.maxnevents = std::max(group.maxnevents, cases.back().maxnevents);
+    }
+
+    //END OF CONFIGURATION
+
+    TH1::AddDirectory(kFALSE);
+    bool writeUnnormalised = (n_jobs > 1);
+
+    for (const GeneratorGroup_t &group : groups) {
+
+        printf("Generating %d events for", group.maxnevents);
+        for (int icase : group.cases) printf(" %s", cases[icase].name.data());
+        printf("\n");
+
+        std::vector<HadronHistos_t> histos = GenerateGroup(group, cases, cislo, n_threads);
+        if (histos.empty()) return 1;
+
+        for (size_t i = 0; i < group.cases.size(); ++i) {
+            const HadronCase_t &c = cases[group.cases[i]];
+            HadronHistos_t &merged = histos[i];
+            if (!writeUnnormalised) {
+                double norm_fact = merged.normFactor(c.correction);
+                printf("%s: norm fact %f\n", c.name.data(), norm_fact);
+                merged.normalise(norm_fact);
+            }
+            TFile *fout = new TFile(c.outputfile.data(), "recreate");
+            fout->cd();
+            merged.write(writeUnnormalised);
+            fout->Close();
         }
     }
-    hycharmcross->Scale(norm_fact);
-    hycross->Scale(norm_fact);
-    printf("nAccepted %ld, nTried %ld\n", pythia.info.nAccepted(), pythia.info.nTried());
-    printf("pythia.info.sigmaGen() %f\n", pythia.info.sigmaGen());
-    printf("N myhadron %d", nmyhadron);
-    hptcross -> Write();
-    hptyields_unnorm->Write();
-    hptycharmcross->Write();
-    hycharmcross->Write();
-    hycross->Write();
-    fout->Write();
     return 0;
 }
@@ -0,0 +1,129 @@
+// Histograms filled by examplehadron and their normalisation, shared with mergehadron
+
+#ifndef HADRONHISTOS_H
+#define HADRONHISTOS_H
+
+#include <string>
+#include <cstdio>
+#include "TH1F.h"
+#include "TH1D.h"
+#include "TH2F.h"
+#include "TFile.h"
+#include "TString.h"
+
+// weight sums needed to normalise the histograms of one or more Pythia instances. They are written unnormalised to the
+// output of the multi-process runs, so that summing the files (mergehadron or hadd) keeps the normalisation exact.
+// weightSum is the sum of the Pythia event weights (nAccepted for unweighted generation), sumw and sumw2 the sums of the
+// weights the histograms are filled with (Pythia weight times charm-enrichment weight), used for the effective sample size
+enum { kSigmaGenTimesWeightSum = 1, kWeightSum, kNAccepted, kNTried, kNGenerators, kSumW, kSumW2, kNNormWeights = kSumW2 };
+
+struct HadronHistos_t {
+
+    TH1F *hparticlept = nullptr;
+    TH1F *hptyields_unnorm = nullptr;
+    TH1F *hptcross = nullptr;
+    TH1F *hycharmcross = nullptr;
+    TH1F *hycross = nullptr;
+    TH2F *hptycharmcross = nullptr;
+    TH1D *hnormweights = nullptr;
+
+    void book(const std::string &myhadronname, const std::string &myhadronlatex, int nptbins, double ptmin, double ptmax) {
+        hparticlept = new TH1F("hchargedparticles_pt", ";p_{T};charged particle dN/dp_{T}", nptbins, ptmin, ptmax);
+        hptyields_unnorm = new TH1F(Form("h%syieldsvspt_unnorm", myhadronname.data()), ";p_{T} (GeV);unnormalized yield (particle+anti)", nptbins, ptmin, ptmax);
+        hptcross = new TH1F(Form("h%scrossvspt", myhadronname.data()), Form(";p_{T} (GeV);%s d#sigma^{PYTHIA}/dp_{T} (#mu b/GeV)", myhadronlatex.data()), nptbins, ptmin, ptmax);
+        hycharmcross = new TH1F("hycharmcross", ";y;%s d#sigma_{c}^{PYTHIA}/dy (#mu b)", 61, -30.5, 30.5);
+        hycross = new TH1F("hycross", ";y;%s d#sigma_{HF}^{PYTHIA}/dy (#mu b)", 61, -30.5, 30.5);
+        hptycharmcross = new TH2F("hptcharmcross", ";p_{T} (GeV); y", 100, 0., 100.,60, -30., 30.);
+        hparticlept->Sumw2();
+        hptyields_unnorm->Sumw2();
+        hptcross->Sumw2();
+        hycharmcross->Sumw2();
+        hycross->Sumw2();
+        hptycharmcross->Sumw2();
+        hnormweights = new TH1D("hnormweights", ";;sum over generators", kNNormWeights, 0.5, kNNormWeights+0.5);
+        hnormweights->GetXaxis()->SetBinLabel(kSigmaGenTimesWeightSum, "sigmaGen*weightSum (mb)");
+        hnormweights->GetXaxis()->SetBinLabel(kWeightSum, "weightSum");
+        hnormweights->GetXaxis()->SetBinLabel(kNAccepted, "nAccepted");
+        hnormweights->GetXaxis()->SetBinLabel(kNTried, "nTried");
+        hnormweights->GetXaxis()->SetBinLabel(kNGenerators, "nGenerators");
+        hnormweights->GetXaxis()->SetBinLabel(kSumW, "sumw");
+        hnormweights->GetXaxis()->SetBinLabel(kSumW2, "sumw2");
+    }
+
+    // reads the histograms of an unnormalised output file
+    bool read(TFile *fin, const std::string &myhadronname) {
+        hparticlept = (TH1F*) fin->Get("hchargedparticles_pt");
+        hptyields_unnorm = (TH1F*) fin->Get(Form("h%syieldsvspt_unnorm", myhadronname.data()));
+        hptcross = (TH1F*) fin->Get(Form("h%scrossvspt", myhadronname.data()));
+        hycharmcross = (TH1F*) fin->Get("hycharmcross");
+        hycross = (TH1F*) fin->Get("hycross");
+        hptycharmcross = (TH2F*) fin->Get("hptcharmcross");
+        hnormweights = (TH1D*) fin->Get("hnormweights");
+        return hparticlept && hptyields_unnorm && hptcross && hycharmcross && hycross && hptycharmcross && hnormweights;
+    }
+
+    void addGenerator(double sigmaGen, double weightSum, long nAccepted, long nTried, double sumw, double sumw2) {
+        hnormweights->AddBinContent(kSigmaGenTimesWeightSum, sigmaGen*weightSum);
+        hnormweights->AddBinContent(kWeightSum, weightSum);
+        hnormweights->AddBinContent(kNAccepted, nAccepted);
+        hnormweights->AddBinContent(kNTried, nTried);
+        hnormweights->AddBinContent(kNGenerators, 1);
+        hnormweights->AddBinContent(kSumW, sumw);
+        hnormweights->AddBinContent(kSumW2, sumw2);
+    }
+
+    void add(const HadronHistos_t &other) {
+        hparticlept->Add(other.hparticlept);
+        hptyields_unnorm->Add(other.hptyields_unnorm);
+        hptcross->Add(other.hptcross);
+        hycharmcross->Add(other.hycharmcross);
+        hycross->Add(other.hycross);
+        hptycharmcross->Add(other.hptycharmcross);
+        hnormweights->Add(other.hnormweights);
+    }
+
+    // cross section per unit of event weight in mub, averaged over particle and antiparticle. The cross sections of the
+    // generators are combined weighted by their sums of weights
+    double normFactor(double correction) const {
+        double weightSum = hnormweights->GetBinContent(kWeightSum);
+        if (weightSum <= 0) return 0;
+        double sigmaGen = hnormweights->GetBinContent(kSigmaGenTimesWeightSum)/weightSum;
+        return correction*sigmaGen*1000/(2*weightSum);
+    }
+
+    double sigmaGen() const {
+        double weightSum = hnormweights->GetBinContent(kWeightSum);
+        return weightSum > 0 ? hnormweights->GetBinContent(kSigmaGenTimesWeightSum)/weightSum : 0;
+    }
+
+    // effective number of events, (sum w)^2/sum w^2
+    double effectiveEvents() const {
+        double sumw2 = hnormweights->GetBinContent(kSumW2);
+        return sumw2 > 0 ? hnormweights->GetBinContent(kSumW)*hnormweights->GetBinContent(kSumW)/sumw2 : 0;
+    }
+
+    void printSummary(const char *name) const {
+        printf("%s: nAccepted %.0f, nTried %.0f, sigmaGen %f mb\n", name, hnormweights->GetBinContent(kNAccepted), hnormweights->GetBinContent(kNTried), sigmaGen());
+        printf("%s: effective sample size %.1f events, %.1f entries in %s\n", name, effectiveEvents(), hptcross->GetEffectiveEntries(), hptcross->GetName());
+    }
+
+    void normalise(double norm_fact) {
+        hptcross->Scale(norm_fact, "width");
+        hptycharmcross->Scale(norm_fact, "width");
+        hycharmcross->Scale(norm_fact);
+        hycross->Scale(norm_fact);
+    }
+
+    void write(bool withNormWeights) {
+        hparticlept->Write();
+        hptcross->Write();
+        hptyields_unnorm->Write();
+        hptycharmcross->Write();
+        hycharmcross->Write();
+        hycross->Write();
+        if (withNormWeights) hnormweights->Write();
+    }
+
+} ;
+
+#endif
@@ -1,6 +1,13 @@
 export CASEFILE=case.sh
 source $CASEFILE
-rm $OUTPUTFOLDER/$CASE.root
-rm ../InputsTheory/$CASE.root
-hadd $OUTPUTFOLDER/$CASE.root $OUTPUTFOLDER/file_*/$CASE.root
-cp $OUTPUTFOLDER/$CASE.root ../InputsTheory/$CASE.root
+for C in ${CASE//,/ }
+do
+   rm $OUTPUTFOLDER/$C.root
+   rm ../InputsTheory/$C.root
+   if [ $NJOBS -gt 1 ]; then
+      ./mergehadron.exe $C $OUTPUTFOLDER/$C.root $OUTPUTFOLDER/file_*/$C.root
+   else
+      cp $OUTPUTFOLDER/file_1/$C.root $OUTPUTFOLDER/$C.root
+   fi
+   cp $OUTPUTFOLDER/$C.root ../InputsTheory/$C.root
+done
@@ -0,0 +1,66 @@
+// This macro merges the unnormalised outputs of the examplehadron jobs of one case and normalises
+// the merged histograms from the summed weights, e.g.
+//   ./mergehadron.exe <case> merged.root file_1/<case>.root file_2/<case>.root ...
+// Jobs that crashed before writing their output simply don't enter the sums
+
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include "TFile.h"
+#include "TH1.h"
+#include <yaml-cpp/yaml.h>
+#include "hadronhistos.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s <case> <output.root> <input1.root> [input2.root ...]\n", argv[0]);
+        return 1;
+    }
+    std::string mycase = argv[1];
+    const char *outputfile = argv[2];
+
+    YAML::Node node = YAML::LoadFile("config.yaml");
+    YAML::Node nodecase = node[mycase.data()];
+    const std::string myhadronname = nodecase["myhadronname"].as<std::string>();
+    float correction = nodecase["correction"].as<float>();
+
+    TH1::AddDirectory(kFALSE);
+    HadronHistos_t merged;
+    int nfiles = 0;
+    for (int iarg = 3; iarg < argc; ++iarg) {
+        TFile *fin = TFile::Open(argv[iarg]);
+        if (!fin || fin->IsZombie()) {
+            printf("Could not open %s, skipping it\n", argv[iarg]);
+            continue;
+        }
+        HadronHistos_t histos;
+        if (!histos.read(fin, myhadronname)) {
+            printf("%s is not an unnormalised examplehadron output, skipping it\n", argv[iarg]);
+            fin->Close();
+            continue;
+        }
+        if (nfiles == 0) {
+            merged = histos;
+        } else {
+            merged.add(histos);
+        }
+        ++nfiles;
+        fin->Close();
+    }
+    if (nfiles == 0) {
+        printf("No input to merge\n");
+        return 1;
+    }
+
+    double norm_fact = merged.normFactor(correction);
+    printf("merged %d files, %.0f generators\n", nfiles, merged.hnormweights->GetBinContent(kNGenerators));
+    merged.printSummary(mycase.data());
+    printf("norm fact %f\n", norm_fact);
+    merged.normalise(norm_fact);
+
+    TFile *fout = new TFile(outputfile, "recreate");
+    fout->cd();
+    merged.write(false);
+    fout->Close();
+    return 0;
+}
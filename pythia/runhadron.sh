@@ -3,8 +3,6 @@ SETUPFILE=/home/pyadmin/software/setup_scripts/setup-pythia8.sh #contains env. v
 COMPILER=compile_pythia.sh
 export CASEFILE=case.sh
 source $CASEFILE
-NJOBS=50 #WARNING: BE AWARE THAT THE FILES PRODUCED BY EACH JOB WILL HAVE 
-	 #1/NJOBS AS NORMALIZATION, TO PRODUCE MERGED FILES PROPERLY NORMALIZED.
 echo "----------------------------------"
 echo "----------------------------------"
 echo "----------------------------------"
@@ -17,6 +15,7 @@ echo "----------------------------------"
 rm *.root *.exe
 source $SETUPFILE
 ./$COMPILER examplehadron
+./$COMPILER mergehadron
 
 rm -rf $OUTPUTFOLDER
 mkdir $OUTPUTFOLDER
@@ -25,10 +24,10 @@ for i in $( eval echo {1..$NJOBS} )
 do
    mkdir file_$i
    cd file_$i
-   cp ../../examplehadron.exe .
    cp ../../config.yaml .
-   echo $RANDOM
-   ./examplehadron.exe $CASE $RANDOM $NJOBS &
+   SEED=$((BASESEED + i))
+   echo $SEED
+   ../../examplehadron.exe $CASE $SEED $NJOBS $NTHREADS &
    cd ..
 done
 